@@ -2,78 +2,666 @@
 #include <ctime>
 #include "nlohmann/json.hpp"
 #include <fstream>
+#include <sstream>
+#include <iomanip>
 
 #include <vector>
+#include <new>
 #include <random>
+#include <array>
+#include <cstdint>
 #include <cmath>
 #include <cstdlib>
 
 #include <queue>
+#include <unordered_set>
+#include <algorithm>
+#include <numeric>
 
 #include <chrono>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
 
 using namespace std;
 using json = nlohmann::json;
 int x =0;
-// Define random number generator
-random_device rd;
-mt19937 gen(rd());
 
-void dfs(const vector<vector<int>>& matrix, int vertex, vector<bool>& visited){
-    visited[vertex]=true;
-    for(int i=0; i<matrix.size();++i){
-        if(matrix[vertex][i]!=numeric_limits<int>::max() && !visited[i]){
-            dfs(matrix,i,visited);
+// Counter-based Philox4x32-10 random number generator. Every (seed, stream) pair gives an
+// independent deterministic sequence, so threads and trials never share a generator state.
+struct Philox{
+    using result_type=uint32_t;
+
+    array<uint32_t,2> key;
+    array<uint32_t,4> counter; // counter[0..1] is the block number, counter[2..3] the stream
+    array<uint32_t,4> block;
+    int index=4;
+
+    Philox(uint64_t seed=0, uint64_t stream=0){
+        key={uint32_t(seed),uint32_t(seed>>32)};
+        counter={0,0,uint32_t(stream),uint32_t(stream>>32)};
+    }
+    static constexpr result_type min(){
+        return 0;
+    }
+    static constexpr result_type max(){
+        return numeric_limits<uint32_t>::max();
+    }
+    result_type operator()(){
+        if(index==4){
+            block=generateBlock();
+            index=0;
+            // Next block
+            if(++counter[0]==0){
+                counter[1]++;
+            }
+        }
+        return block[index++];
+    }
+    array<uint32_t,4> generateBlock() const{
+        array<uint32_t,4> c=counter;
+        array<uint32_t,2> k=key;
+        for(int round=0;round<10;++round){
+            uint64_t p0=uint64_t(0xD2511F53)*c[0];
+            uint64_t p1=uint64_t(0xCD9E8D57)*c[2];
+            c={uint32_t(p1>>32)^c[1]^k[0],uint32_t(p1),uint32_t(p0>>32)^c[3]^k[1],uint32_t(p0)};
+            k[0]+=0x9E3779B9;
+            k[1]+=0xBB67AE85;
+        }
+        return c;
+    }
+};
+
+// Random generator context of a run, the seed is printed so the run can be replayed
+struct RandomContext{
+    uint64_t seed;
+
+    Philox stream(uint64_t id) const{
+        return Philox(seed,id);
+    }
+};
+// Streams used by the stages of a run
+enum RandomStream : uint64_t{
+    GRAPH_STREAM=0, FLOW_STREAM=1, PICK_STREAM=2,
+    // Parallel generators give every fixed block its own stream, base + block number
+    PAIR_BLOCK_STREAMS=1ULL<<32, EDGE_BLOCK_STREAMS=2ULL<<32, FLOW_BLOCK_STREAMS=3ULL<<32
+};
+// Number of threads used by parallel solvers
+int flow_threads=max(1u,thread::hardware_concurrency());
+
+// Allocator giving every block its own cache lines
+const size_t CACHE_LINE=64;
+template<class T>
+struct AlignedAllocator{
+    using value_type=T;
+
+    AlignedAllocator()=default;
+    template<class U>
+    AlignedAllocator(const AlignedAllocator<U>&){}
+    T* allocate(size_t count){
+        return static_cast<T*>(::operator new(count*sizeof(T),align_val_t(CACHE_LINE)));
+    }
+    void deallocate(T* p, size_t){
+        ::operator delete(p,align_val_t(CACHE_LINE));
+    }
+    template<class U>
+    bool operator==(const AlignedAllocator<U>&) const{
+        return true;
+    }
+    template<class U>
+    bool operator!=(const AlignedAllocator<U>&) const{
+        return false;
+    }
+};
+
+// Dense row-major matrix in a single allocation. Rows are padded to whole cache lines, so every
+// row starts on a line of its own, and copying the matrix is one block copy instead of one per row.
+template<class T>
+struct Matrix{
+    int rows=0;
+    int cols=0;
+    size_t stride=0; // Distance between the starts of two rows
+    vector<T,AlignedAllocator<T>> data;
+
+    Matrix()=default;
+    Matrix(int rows, int cols, T value=T()): rows(rows), cols(cols){
+        size_t per_line=max<size_t>(1,CACHE_LINE/sizeof(T));
+        stride=(cols+per_line-1)/per_line*per_line;
+        data.assign(rows*stride,value);
+    }
+    // Number of rows, matrices are square where this is used
+    size_t size() const{
+        return rows;
+    }
+    T& operator()(int i, int j){
+        return data[i*stride+j];
+    }
+    const T& operator()(int i, int j) const{
+        return data[i*stride+j];
+    }
+};
+
+// Symmetric n*n matrix packed as its upper triangle with the diagonal, row by row, in about
+// half the memory of Matrix. (i,j) and (j,i) are the same element. Functions taking a dense
+// matrix accept both through m(i,j), directed flows need the full Matrix.
+template<class T>
+struct SymmetricMatrix{
+    int n=0;
+    vector<T,AlignedAllocator<T>> data;
+
+    SymmetricMatrix()=default;
+    // Same arguments as Matrix so generic code can build either, the matrix is always rows*rows
+    SymmetricMatrix(int rows, int /*cols*/, T value=T()): n(rows), data(size_t(rows)*(rows+1)/2,value){}
+    size_t size() const{
+        return n;
+    }
+    // Position of element (i,j), row i of the triangle starts after the i longer rows above it
+    size_t index(int i, int j) const{
+        if(i>j){
+            swap(i,j);
+        }
+        return size_t(i)*n-size_t(i)*(i-1)/2+(j-i);
+    }
+    T& operator()(int i, int j){
+        return data[index(i,j)];
+    }
+    const T& operator()(int i, int j) const{
+        return data[index(i,j)];
+    }
+};
+
+// Edge used to build a CSR graph, both arcs share the length but have their own capacity
+struct Edge{
+    int u,v;
+    int length;
+    int capacity;      // Capacity of arc u->v
+    int back_capacity; // Capacity of arc v->u
+};
+
+// Compressed sparse row graph, every edge is stored as two arcs, a one-way edge has a zero capacity arc
+struct CSRGraph{
+    int n=0;
+    vector<int> offsets;    // Arcs of vertex v are offsets[v]..offsets[v+1]-1
+    vector<int> targets;    // Head of every arc, sorted inside each vertex
+    vector<int> capacities; // Flow capacity of every arc
+    vector<int> lengths;    // Distance of every arc
+
+    int degree(int v) const{
+        return offsets[v+1]-offsets[v];
+    }
+    // Index of arc u->v or -1 if there is no such arc
+    int arc(int u, int v) const{
+        auto first=targets.begin()+offsets[u];
+        auto last=targets.begin()+offsets[u+1];
+        auto it=lower_bound(first,last,v);
+        if(it==last || *it!=v){
+            return -1;
+        }
+        return int(it-targets.begin());
+    }
+};
+
+CSRGraph buildCSR(int n, const vector<Edge>& edges){
+    CSRGraph g;
+    g.n=n;
+    g.offsets.assign(n+1,0);
+    for(const Edge& e : edges){
+        g.offsets[e.u+1]++;
+        g.offsets[e.v+1]++;
+    }
+    for(int i=0;i<n;++i){
+        g.offsets[i+1]+=g.offsets[i];
+    }
+    int m=g.offsets[n];
+    g.targets.resize(m);
+    g.capacities.resize(m);
+    g.lengths.resize(m);
+
+    // Bucket arcs by target first, then place them by source in that order,
+    // so targets end up sorted inside every vertex without a comparison sort
+    vector<int> by_target(m);
+    vector<int> pos(g.offsets.begin(),g.offsets.end()-1);
+    for(int k=0;k<int(edges.size());++k){
+        by_target[pos[edges[k].v]++]=2*k;   // arc u->v
+        by_target[pos[edges[k].u]++]=2*k+1; // arc v->u
+    }
+    pos.assign(g.offsets.begin(),g.offsets.end()-1);
+    for(int a : by_target){
+        const Edge& e=edges[a/2];
+        int from=(a%2==0)?e.u:e.v;
+        int to=(a%2==0)?e.v:e.u;
+        int slot=pos[from]++;
+        g.targets[slot]=to;
+        g.capacities[slot]=(a%2==0)?e.capacity:e.back_capacity;
+        g.lengths[slot]=e.length;
+    }
+    return g;
+}
+
+// Convert dense graph and flow matrices into a CSR graph
+template<class GraphMatrix, class FlowMatrix>
+CSRGraph toCSR(const GraphMatrix& graph, const FlowMatrix& flow_matrix){
+    int n=graph.size();
+    vector<Edge> edges;
+    for(int i=0;i<n;++i){
+        for(int j=i+1;j<n;++j){
+            if(graph(i,j)!=numeric_limits<int>::max()){
+                edges.push_back({i,j,graph(i,j),flow_matrix(i,j),flow_matrix(j,i)});
+            }
         }
     }
+    return buildCSR(n,edges);
 }
-bool is_connected(const vector<vector<int>>& matrix){
+
+// Iterative search over the dense matrix with an explicit stack. Each popped vertex only tests
+// the still unvisited vertices, so dense graphs finish after far fewer than n*n checks.
+template<class M>
+bool is_connected(const M& matrix){
     int n=matrix.size();
-    vector<bool> visited(n,false);
-    dfs(matrix,0,visited);
+    if(n==0){
+        return true;
+    }
+    vector<int> unvisited(n-1);
+    iota(unvisited.begin(),unvisited.end(),1);
+    vector<int> stack={0};
+    while(!stack.empty() && !unvisited.empty()){
+        int u=stack.back();
+        stack.pop_back();
+        for(size_t k=0;k<unvisited.size();){
+            int v=unvisited[k];
+            if(matrix(u,v)!=numeric_limits<int>::max()){
+                stack.push_back(v);
+                unvisited[k]=unvisited.back();
+                unvisited.pop_back();
+            }
+            else{
+                k++;
+            }
+        }
+    }
     // Check if all vertices were visited
-    bool allVerticesVisited=true;
-    for(bool v : visited){
-        if(!v){
-            allVerticesVisited=false;
-            break;
+    return unvisited.empty();
+}
+
+bool is_connected(const CSRGraph& g){
+    if(g.n==0){
+        return true;
+    }
+    vector<bool> visited(g.n,false);
+    vector<int> stack={0};
+    visited[0]=true;
+    int seen=1;
+    while(!stack.empty() && seen<g.n){
+        int u=stack.back();
+        stack.pop_back();
+        for(int e=g.offsets[u];e<g.offsets[u+1];++e){
+            int v=g.targets[e];
+            if(!visited[v]){
+                visited[v]=true;
+                seen++;
+                stack.push_back(v);
+            }
         }
     }
-    return allVerticesVisited;
+    return seen==g.n;
 }
 
-vector<vector<int>> generateGraph(int n, float d, int r){
-    int rate=int(d*(n*(n-1)/2)); // Calculate graph saturation factor
-    vector<vector<int>> matrix(n,vector<int>(n,numeric_limits<int>::max())); //Create the matrix filed with infinity
-    for(int i=0;i<n;i++){ // Fill the diagonal with 0s
-        matrix[i][i]=0;
+// Pair i<j with index k, pairs are numbered row by row: (0,1),(0,2)..(0,n-1),(1,2)..
+pair<int,int> pairFromIndex(long long k, int n){
+    auto row_start=[n](long long i){
+        return i*(2LL*n-i-1)/2;
+    };
+    double b=2.0*n-1;
+    long long i=(long long)((b-sqrt(max(0.0,b*b-8.0*k)))/2);
+    i=max(0LL,min(i,(long long)n-2));
+    while(i>0 && row_start(i)>k){
+        i--;
+    }
+    while(i<n-2 && row_start(i+1)<=k){
+        i++;
     }
-    for(int _=0;_<rate;_++){
-        int v1=uniform_int_distribution<>(0,n-1)(gen);
-        int v2=uniform_int_distribution<>(0,n-1)(gen);
-        while(matrix[v1][v2] != numeric_limits<int>::max() || matrix[v2][v1]!=numeric_limits<int>::max() || v1==v2){
-            v1=uniform_int_distribution<>(0,n-1)(gen);
-            v2=uniform_int_distribution<>(0,n-1)(gen);
+    return {int(i),int(i+1+k-row_start(i))};
+}
+
+// Index of pair i<j, inverse of pairFromIndex
+long long pairIndex(int i, int j, int n){
+    return (long long)i*(2LL*n-i-1)/2+(j-i-1);
+}
+
+// Exactly rate distinct unordered pairs with index in [lo,hi) in O(rate), never one of the
+// sorted excluded pair indices. Sparse ranges use Floyd's sampling over the ranks of allowed
+// pairs, ranges denser than 1/2 pick the missing pairs the same way.
+vector<pair<int,int>> samplePairRange(int n, long long lo, long long hi, long long rate, Philox& gen, const vector<long long>& excluded){
+    long long available=hi-lo-excluded.size();
+    rate=max(0LL,min(rate,available));
+    bool complement=2*rate>available;
+    long long picks=complement?available-rate:rate;
+
+    unordered_set<long long> chosen;
+    chosen.reserve(picks);
+    vector<long long> order; // Insertion order keeps the result independent of hashing
+    order.reserve(picks);
+    for(long long j=available-picks;j<available;++j){
+        long long t=uniform_int_distribution<long long>(0,j)(gen);
+        long long pick=chosen.insert(t).second?t:j;
+        if(pick==j){
+            chosen.insert(j);
+        }
+        order.push_back(pick);
+    }
+
+    vector<pair<int,int>> pairs;
+    pairs.reserve(rate);
+    if(!complement){
+        for(long long rank : order){
+            // Smallest index with rank allowed pairs before it
+            long long k=lo+rank;
+            while(true){
+                long long skipped=upper_bound(excluded.begin(),excluded.end(),k)-excluded.begin();
+                if(lo+rank+skipped==k){
+                    break;
+                }
+                k=lo+rank+skipped;
+            }
+            pairs.push_back(pairFromIndex(k,n));
         }
-        uniform_int_distribution<> dis(1,r); // Set range of possible distances between vertices
-        int value=dis(gen);
-        matrix[v1][v2]=value;
-        matrix[v2][v1]=value;
+        return pairs;
     }
-    if(is_connected(matrix)==1){
-   		return matrix;
+    if(lo==hi){
+        return pairs;
     }
-    else{
-    	cout << "TRY AGAIN" << endl;
-    	return generateGraph(n,d,r);
+    long long rank=0;
+    auto skip=excluded.begin();
+    auto [i,j]=pairFromIndex(lo,n);
+    for(long long k=lo;k<hi;++k){
+        if(skip!=excluded.end() && *skip==k){
+            skip++;
+        }
+        else{
+            if(!chosen.count(rank)){
+                pairs.push_back({i,j});
+            }
+            rank++;
+        }
+        // Next pair in index order
+        if(++j==n){
+            i++;
+            j=i+1;
+        }
+    }
+    return pairs;
+}
+
+vector<pair<int,int>> samplePairs(int n, long long rate, Philox& gen, const vector<long long>& excluded={}){
+    return samplePairRange(n,0,(long long)n*(n-1)/2,rate,gen,excluded);
+}
+
+// Run body(begin,end,block) for fixed blocks of [0,count) on the given number of threads.
+// Blocks do not depend on the thread count, so per-block streams give identical results.
+void parallelBlocks(long long count, long long block_size, int threads, const function<void(long long,long long,long long)>& body){
+    long long blocks=(count+block_size-1)/block_size;
+    atomic<long long> next(0);
+    auto worker=[&](){
+        for(long long b=next++;b<blocks;b=next++){
+            body(b*block_size,min(count,(b+1)*block_size),b);
+        }
+    };
+    vector<thread> pool;
+    for(int t=1;t<min<long long>(threads,blocks);++t){
+        pool.emplace_back(worker);
+    }
+    worker();
+    for(thread& th : pool){
+        th.join();
     }
 }
 
-void printMatrix(const vector<vector<int>>& matrix){
+// Disjoint sets with union by size and path halving, components is kept up to date
+struct DisjointSets{
+    vector<int> parent;
+    vector<int> size;
+    int components;
+
+    DisjointSets(int n): parent(n), size(n,1), components(n){
+        iota(parent.begin(),parent.end(),0);
+    }
+    int find(int v){
+        while(parent[v]!=v){
+            parent[v]=parent[parent[v]];
+            v=parent[v];
+        }
+        return v;
+    }
+    // Returns false when a and b were already in the same component
+    bool unite(int a, int b){
+        a=find(a);
+        b=find(b);
+        if(a==b){
+            return false;
+        }
+        if(size[a]<size[b]){
+            swap(a,b);
+        }
+        parent[b]=a;
+        size[a]+=size[b];
+        components--;
+        return true;
+    }
+};
+
+// Edges joining the components of sets into one, they form a random tree over the components
+vector<pair<int,int>> joiningEdges(int n, DisjointSets& sets, Philox& gen){
+    vector<pair<int,int>> edges;
+    if(sets.components<=1){
+        return edges;
+    }
+    vector<int> index(n,-1);
+    vector<vector<int>> members;
+    for(int v=0;v<n;++v){
+        int root=sets.find(v);
+        if(index[root]<0){
+            index[root]=members.size();
+            members.emplace_back();
+        }
+        members[index[root]].push_back(v);
+    }
+    shuffle(members.begin(),members.end(),gen);
+    for(size_t k=1;k<members.size();++k){
+        const vector<int>& a=members[k];
+        const vector<int>& b=members[uniform_int_distribution<size_t>(0,k-1)(gen)];
+        int v1=a[uniform_int_distribution<size_t>(0,a.size()-1)(gen)];
+        int v2=b[uniform_int_distribution<size_t>(0,b.size()-1)(gen)];
+        edges.push_back({min(v1,v2),max(v1,v2)});
+    }
+    return edges;
+}
+
+// Make the sampled graph connected. Union-find follows the components while the edges go in,
+// edges closing a cycle are redundant and their slots go to edges joining the components.
+void joinComponents(int n, vector<pair<int,int>>& pairs, Philox& gen){
+    DisjointSets sets(n);
+    vector<size_t> redundant; // Positions of edges that closed a cycle
+    for(size_t k=0;k<pairs.size();++k){
+        if(!sets.unite(pairs[k].first,pairs[k].second)){
+            redundant.push_back(k);
+        }
+    }
+    if(sets.components<=1){
+        return;
+    }
+    vector<pair<int,int>> joining=joiningEdges(n,sets,gen);
+    shuffle(redundant.begin(),redundant.end(),gen);
+    for(const auto& edge : joining){
+        if(!redundant.empty()){
+            pairs[redundant.back()]=edge;
+            redundant.pop_back();
+        }
+        else{
+            pairs.push_back(edge); // Fewer than n-1 edges can not connect the graph
+        }
+    }
+}
+
+// Random recursive tree: every vertex of a random order hangs below an earlier one.
+// Adds the tree edges to pairs and returns their sorted pair indices.
+vector<long long> randomTree(int n, vector<pair<int,int>>& pairs, Philox& gen){
+    vector<int> order(n);
+    iota(order.begin(),order.end(),0);
+    shuffle(order.begin(),order.end(),gen);
+    vector<long long> tree;
+    for(int k=1;k<n;++k){
+        int parent=order[uniform_int_distribution<>(0,k-1)(gen)];
+        int v1=min(parent,order[k]);
+        int v2=max(parent,order[k]);
+        pairs.push_back({v1,v2});
+        tree.push_back(pairIndex(v1,v2,n));
+    }
+    sort(tree.begin(),tree.end());
+    return tree;
+}
+
+// Edges of a random connected graph with rate edges, or n-1 when rate is too small.
+// With spanning_tree a random tree comes first and the rest is sampled among the other pairs,
+// otherwise the edges are sampled uniformly and the components joined by joinComponents.
+vector<pair<int,int>> generateEdgePairs(int n, long long rate, bool spanning_tree, Philox& gen){
+    if(!spanning_tree || n<2){
+        vector<pair<int,int>> pairs=samplePairs(n,rate,gen);
+        joinComponents(n,pairs,gen);
+        return pairs;
+    }
+    vector<pair<int,int>> pairs;
+    vector<long long> tree=randomTree(n,pairs,gen);
+    vector<pair<int,int>> rest=samplePairs(n,rate-(n-1),gen,tree);
+    pairs.insert(pairs.end(),rest.begin(),rest.end());
+    return pairs;
+}
+
+// Same graphs as generateEdgePairs, built in parallel. The pair space is cut into partitions
+// of PARTITION_PAIRS pairs, every partition samples its share of edges from its own stream,
+// so the result is bit-identical for any number of threads.
+const long long PARTITION_PAIRS=1<<22;
+
+// Splits rate edges between the partitions in partition order, each one gets its share of the
+// still free pairs. Only the sorted tree pair indices are kept, so the count of partitions
+// does not matter for memory.
+struct PartitionSplitter{
+    long long total;
+    long long free_pairs;
+    long long left;
+    const vector<long long>& tree;
+    size_t next_tree=0;
+    long long partition=0;
+
+    PartitionSplitter(long long total, long long rate, const vector<long long>& tree): total(total), free_pairs(total-tree.size()), tree(tree){
+        left=max(0LL,min(rate,free_pairs));
+    }
+    // Edge count of the next partition, excluded gets its tree pair indices
+    long long next(Philox& gen, vector<long long>& excluded){
+        long long lo=partition*PARTITION_PAIRS;
+        long long hi=min(total,lo+PARTITION_PAIRS);
+        partition++;
+        excluded.clear();
+        while(next_tree<tree.size() && tree[next_tree]<hi){
+            excluded.push_back(tree[next_tree++]);
+        }
+        long long size=hi-lo-excluded.size();
+        long long k=left;
+        if(size<free_pairs){
+            k=binomial_distribution<long long>(left,double(size)/free_pairs)(gen);
+        }
+        long long count=max(left-(free_pairs-size),min({k,size,left}));
+        left-=count;
+        free_pairs-=size;
+        return count;
+    }
+};
+
+vector<pair<int,int>> generateEdgePairsParallel(int n, long long rate, bool spanning_tree, const RandomContext& random, int threads){
+    long long total=(long long)n*(n-1)/2;
+    Philox gen=random.stream(GRAPH_STREAM);
+    vector<pair<int,int>> tree_pairs;
+    vector<long long> tree;
+    if(spanning_tree && n>=2){
+        tree=randomTree(n,tree_pairs,gen);
+        rate-=n-1;
+    }
+
+    long long partitions=max(1LL,(total+PARTITION_PAIRS-1)/PARTITION_PAIRS);
+    vector<long long> counts(partitions);
+    vector<vector<long long>> excluded(partitions);
+    PartitionSplitter split(total,rate,tree);
+    for(long long p=0;p<partitions;++p){
+        counts[p]=split.next(gen,excluded[p]);
+    }
+
+    vector<vector<pair<int,int>>> parts(partitions);
+    parallelBlocks(total,PARTITION_PAIRS,threads,[&](long long lo, long long hi, long long p){
+        Philox part_gen=random.stream(PAIR_BLOCK_STREAMS+p);
+        parts[p]=samplePairRange(n,lo,hi,counts[p],part_gen,excluded[p]);
+    });
+
+    vector<pair<int,int>> pairs=move(tree_pairs);
+    for(auto& part : parts){
+        pairs.insert(pairs.end(),part.begin(),part.end());
+    }
+    if(!spanning_tree){
+        joinComponents(n,pairs,gen);
+    }
+    return pairs;
+}
+
+// The graph is connected by construction and is never regenerated,
+// a density below 2/n still gets n-1 edges
+SymmetricMatrix<int> generateGraph(int n, float d, int r, Philox& gen, bool spanning_tree=true){
+    long long rate=(long long)(double(d)*((long long)n*(n-1)/2)); // Calculate graph saturation factor
+    SymmetricMatrix<int> matrix(n,n,numeric_limits<int>::max()); //Create the matrix filed with infinity
+    for(int i=0;i<n;i++){ // Fill the diagonal with 0s
+        matrix(i,i)=0;
+    }
+    uniform_int_distribution<> dis(1,r); // Set range of possible distances between vertices
+    for(auto [v1,v2] : generateEdgePairs(n,rate,spanning_tree,gen)){
+        matrix(v1,v2)=dis(gen);
+    }
+    return matrix;
+}
+
+// Edges per random stream of generateCSRGraphParallel
+const long long EDGE_BLOCK=1<<16;
+
+// Distances and capacities of one block of edges, drawn from the block's own stream
+void fillEdgeBlock(const pair<int,int>* pairs, Edge* edges, long long count, int r, int f, bool directed, Philox gen){
+    uniform_int_distribution<> dis(1,r); // Set range of possible distances between vertices
+    uniform_int_distribution<> flow(1,max(f,1));
+    for(long long k=0;k<count;++k){
+        int length=dis(gen);
+        int capacity=f>0?flow(gen):0;
+        int back_capacity=(f>0 && directed)?flow(gen):capacity;
+        edges[k]={pairs[k].first,pairs[k].second,length,capacity,back_capacity};
+    }
+}
+
+// Generate a graph straight into CSR form, without the n*n matrix. With f>0 every edge also
+// gets its capacity in the same pass, so generateFlowParallel and its copy of the graph are not
+// needed. With directed the capacity of every direction is drawn on its own.
+CSRGraph generateCSRGraphParallel(int n, float d, int r, const RandomContext& random, int threads, bool spanning_tree=true, int f=0, bool directed=false){
+    long long rate=(long long)(double(d)*((long long)n*(n-1)/2));
+    vector<pair<int,int>> pairs=generateEdgePairsParallel(n,rate,spanning_tree,random,threads);
+    vector<Edge> edges(pairs.size());
+    parallelBlocks(pairs.size(),EDGE_BLOCK,threads,[&](long long begin, long long end, long long block){
+        fillEdgeBlock(&pairs[begin],&edges[begin],end-begin,r,f,directed,random.stream(EDGE_BLOCK_STREAMS+block));
+    });
+    return buildCSR(n,edges);
+}
+
+template<class M>
+void printMatrix(const M& matrix){
     int n=matrix.size();
     for(int i=0;i<n;++i){
         for (int j=0;j<n;++j){
-            cout << matrix[i][j] << " ";
+            cout << matrix(i,j) << " ";
         }
         cout << endl;
     }
@@ -85,80 +673,759 @@ void sortMatrixByColumn(vector<vector<float>>& matrix, int column) {
     });
 }
 
-void generateGraphImage(const vector<vector<int>>& matrix, const string& filename){
-    ofstream dotFile("graph.dot");
-    dotFile << "graph G {\n";
+// Background render service. Jobs draw from their own snapshot of the data, a pool of workers
+// writes the images while the caller goes on. Destroying the queue finishes
+// the jobs still waiting.
+struct RenderQueue{
+    mutex lock;
+    condition_variable ready;
+    queue<function<void()>> jobs;
+    vector<thread> workers;
+    bool stopping=false;
 
-    int n=matrix.size();
-
-    for(int i=0;i<n;++i){
-        for(int j=i+1;j<n;++j){
-            if(matrix[i][j]!=numeric_limits<int>::max()){
-                dotFile << "  " << i << " -- " << j << " [label=\"" << matrix[i][j] << "\"]\n";
+    RenderQueue(int threads){
+        for(int t=0;t<max(1,threads);++t){
+            workers.emplace_back([this](){
+                work();
+            });
+        }
+    }
+    ~RenderQueue(){
+        {
+            lock_guard<mutex> guard(lock);
+            stopping=true;
+        }
+        ready.notify_all();
+        for(thread& th : workers){
+            th.join();
+        }
+    }
+    void push(function<void()> job){
+        {
+            lock_guard<mutex> guard(lock);
+            jobs.push(move(job));
+        }
+        ready.notify_one();
+    }
+    void work(){
+        while(true){
+            function<void()> job;
+            {
+                unique_lock<mutex> guard(lock);
+                ready.wait(guard,[this](){
+                    return stopping || !jobs.empty();
+                });
+                if(jobs.empty()){
+                    return;
+                }
+                job=move(jobs.front());
+                jobs.pop();
             }
+            job();
         }
     }
+};
+// Render service of the run, without one images are drawn right away by the caller
+RenderQueue* render_queue=nullptr;
 
-    dotFile << "}\n";
-    dotFile.close();
+void submitRender(function<void()> job){
+    if(render_queue){
+        render_queue->push(move(job));
+    }
+    else{
+        job();
+    }
+}
+
+// Image format of the run: png is drawn by Graphviz, svg is written in-process
+string image_format="png";
+
+// Every image gets its own DOT file next to it, so concurrent jobs never share one
+string dotFileName(const string& image){
+    size_t dot=image.rfind('.');
+    return (dot==string::npos?image:image.substr(0,dot))+".dot";
+}
 
-    string command="dot -Tpng graph.dot -o "+filename;
+void renderDot(const string& dot_file, const string& image){
+    string command="dot -Tpng "+dot_file+" -o "+image;
     system(command.c_str());
 }
 
-// Generate a flow matrix based on a graph
-vector<vector<int>> generateFlow(const vector<vector<int>>& graph, int f){
+// Edges of one picture, shared by the Graphviz and the SVG writer
+struct DrawingEdge{
+    int u,v;
+    string label;
+    bool highlight=false; // Drawn in red
+};
+struct Drawing{
+    int n=0;
+    bool directed=false;
+    vector<DrawingEdge> edges;
+};
+
+void writeDot(const Drawing& drawing, const string& dot_file){
+    ofstream dotFile(dot_file);
+    dotFile << (drawing.directed?"digraph G {\n":"graph G {\n");
+    for(const DrawingEdge& e : drawing.edges){
+        dotFile << "  " << e.u << (drawing.directed?" -> ":" -- ") << e.v << " [label=\"" << e.label << "\"";
+        if(e.highlight){
+            dotFile << ", color=\"red\"";
+        }
+        dotFile << "]\n";
+    }
+    dotFile << "}\n";
+}
+
+// Vertices evenly on a circle in the unit square
+vector<pair<double,double>> circleLayout(int n){
+    vector<pair<double,double>> position(n);
+    for(int v=0;v<n;++v){
+        double angle=2*M_PI*v/max(n,1);
+        position[v]={0.5+0.5*cos(angle),0.5+0.5*sin(angle)};
+    }
+    return position;
+}
+
+// Fruchterman-Reingold force layout started from the circle, O(n*n) per step,
+// bigger graphs keep the circle
+const int FORCE_LAYOUT_LIMIT=200;
+vector<pair<double,double>> forceLayout(const Drawing& drawing, int steps=100){
+    int n=drawing.n;
+    vector<pair<double,double>> position=circleLayout(n);
+    if(n<3 || n>FORCE_LAYOUT_LIMIT){
+        return position;
+    }
+    double k=sqrt(1.0/n); // Ideal edge length
+    double temperature=0.1;
+    vector<pair<double,double>> shift(n);
+    for(int step=0;step<steps;++step){
+        fill(shift.begin(),shift.end(),pair<double,double>{0,0});
+        // Every pair of vertices repels
+        for(int u=0;u<n;++u){
+            for(int v=u+1;v<n;++v){
+                double dx=position[u].first-position[v].first;
+                double dy=position[u].second-position[v].second;
+                double dist=max(1e-4,sqrt(dx*dx+dy*dy));
+                double force=k*k/dist;
+                shift[u].first+=dx/dist*force;
+                shift[u].second+=dy/dist*force;
+                shift[v].first-=dx/dist*force;
+                shift[v].second-=dy/dist*force;
+            }
+        }
+        // Edges attract their ends
+        for(const DrawingEdge& e : drawing.edges){
+            double dx=position[e.u].first-position[e.v].first;
+            double dy=position[e.u].second-position[e.v].second;
+            double dist=max(1e-4,sqrt(dx*dx+dy*dy));
+            double force=dist*dist/k;
+            shift[e.u].first-=dx/dist*force;
+            shift[e.u].second-=dy/dist*force;
+            shift[e.v].first+=dx/dist*force;
+            shift[e.v].second+=dy/dist*force;
+        }
+        // Move at most temperature and stay inside the unit square
+        for(int v=0;v<n;++v){
+            double length=max(1e-9,sqrt(shift[v].first*shift[v].first+shift[v].second*shift[v].second));
+            double move=min(length,temperature);
+            position[v].first=min(1.0,max(0.0,position[v].first+shift[v].first/length*move));
+            position[v].second=min(1.0,max(0.0,position[v].second+shift[v].second/length*move));
+        }
+        temperature*=0.95;
+    }
+    return position;
+}
+
+// Write a drawing as an SVG file without Graphviz. Arcs of a directed drawing are moved a little
+// to their right side, so the two arcs between a pair of vertices do not overlap.
+void writeSVG(const Drawing& drawing, const vector<pair<double,double>>& layout, const string& filename){
+    const double size=800, margin=40, radius=12;
+    auto point=[&](int v){
+        return pair<double,double>{margin+layout[v].first*(size-2*margin),margin+layout[v].second*(size-2*margin)};
+    };
+    ofstream svg(filename);
+    svg << fixed << setprecision(1);
+    svg << "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"" << size << "\" height=\"" << size << "\" font-family=\"sans-serif\" font-size=\"11\">\n";
+    svg << "<defs><marker id=\"arrow\" viewBox=\"0 0 10 10\" refX=\"10\" refY=\"5\" markerWidth=\"6\" markerHeight=\"6\" orient=\"auto\"><path d=\"M0,0 L10,5 L0,10 z\"/></marker></defs>\n";
+    for(const DrawingEdge& e : drawing.edges){
+        auto [x1,y1]=point(e.u);
+        auto [x2,y2]=point(e.v);
+        double dx=x2-x1, dy=y2-y1;
+        double length=max(1e-9,sqrt(dx*dx+dy*dy));
+        double ux=dx/length, uy=dy/length;
+        double side=drawing.directed?4:0;
+        // Start and end on the vertex circles
+        double ax=x1+ux*radius-uy*side, ay=y1+uy*radius+ux*side;
+        double bx=x2-ux*radius-uy*side, by=y2-uy*radius+ux*side;
+        const char* color=e.highlight?"red":"black";
+        svg << "<line x1=\"" << ax << "\" y1=\"" << ay << "\" x2=\"" << bx << "\" y2=\"" << by << "\" stroke=\"" << color << "\"";
+        if(drawing.directed){
+            svg << " marker-end=\"url(#arrow)\"";
+        }
+        svg << "/>\n";
+        svg << "<text x=\"" << (ax+bx)/2-uy*8 << "\" y=\"" << (ay+by)/2+ux*8 << "\" fill=\"" << color << "\" text-anchor=\"middle\">" << e.label << "</text>\n";
+    }
+    for(int v=0;v<drawing.n;++v){
+        auto [x,y]=point(v);
+        svg << "<circle cx=\"" << x << "\" cy=\"" << y << "\" r=\"" << radius << "\" fill=\"white\" stroke=\"black\"/>\n";
+        svg << "<text x=\"" << x << "\" y=\"" << y+4 << "\" text-anchor=\"middle\">" << v << "</text>\n";
+    }
+    svg << "</svg>\n";
+}
+
+bool isSVG(const string& image){
+    return image.size()>=4 && image.compare(image.size()-4,4,".svg")==0;
+}
+
+// Draw into an image file, .svg files are written in-process, anything else goes through Graphviz.
+// SVG files use the given layout, or a force layout of the drawing without one.
+void renderDrawing(const Drawing& drawing, const string& image, const vector<pair<double,double>>* layout=nullptr){
+    if(isSVG(image)){
+        writeSVG(drawing,layout?*layout:forceLayout(drawing),image);
+        return;
+    }
+    string dot_file=dotFileName(image);
+    writeDot(drawing,dot_file);
+    renderDot(dot_file,image);
+}
+
+// Distances of an undirected graph matrix
+template<class M>
+Drawing graphDrawing(const M& matrix){
+    Drawing drawing;
+    drawing.n=matrix.size();
+    for(int i=0;i<drawing.n;++i){
+        for(int j=i+1;j<drawing.n;++j){
+            if(matrix(i,j)!=numeric_limits<int>::max()){
+                drawing.edges.push_back({i,j,to_string(matrix(i,j))});
+            }
+        }
+    }
+    return drawing;
+}
+
+// Capacities of a flow matrix, one arc per direction
+template<class M>
+Drawing flowDrawing(const M& flow_matrix){
+    Drawing drawing;
+    drawing.n=flow_matrix.size();
+    drawing.directed=true;
+    for(int i=0;i<drawing.n;++i){
+        for(int j=0;j<drawing.n;++j){
+            if(flow_matrix(i,j)!=0){
+                drawing.edges.push_back({i,j,to_string(flow_matrix(i,j))});
+            }
+        }
+    }
+    return drawing;
+}
+
+template<class M>
+void generateGraphImage(const M& graph, const string& filename){
+    auto snapshot=make_shared<const M>(graph);
+    submitRender([snapshot,filename](){
+        renderDrawing(graphDrawing(*snapshot),filename);
+    });
+}
+
+// Generate a flow matrix based on a graph, with directed both directions get their own capacity.
+// M is the storage of the result, undirected flows fit in a SymmetricMatrix.
+template<class M=Matrix<int>, class GraphMatrix>
+M generateFlow(const GraphMatrix& graph, int f, Philox& gen, bool directed=false){
     int n=graph.size();
-    vector<vector<int>> flow_matrix(n,vector<int>(n,0));
+    M flow_matrix(n,n,0);
 
     // Assign random flow values to edges
     for (int i=0;i<n;++i){
         for (int j=i+1;j<n;++j){
-            if(graph[i][j]!=numeric_limits<int>::max()){
-                flow_matrix[i][j]=uniform_int_distribution<>(1,f)(gen);
-                flow_matrix[j][i]=flow_matrix[i][j];
+            if(graph(i,j)!=numeric_limits<int>::max()){
+                flow_matrix(i,j)=uniform_int_distribution<>(1,f)(gen);
+                if(directed){
+                    flow_matrix(j,i)=uniform_int_distribution<>(1,f)(gen);
+                }
+                else{
+                    flow_matrix(j,i)=flow_matrix(i,j);
+                }
             }
         }
     }
     return flow_matrix;
 }
 
-// Create a Graphviz DOT and PNG file for a flow matrix
-void generateFlowImage(const vector<vector<int>>& flow_matrix, const string& filename){
-    ofstream dotFile("flow.dot");
-    dotFile << "digraph G {\n";
+// Attach random capacities to a CSR graph, both arcs of an edge get the same value unless
+// directed. Every block of vertices draws from its own stream.
+const int VERTEX_BLOCK=1<<12;
+CSRGraph generateFlowParallel(const CSRGraph& graph, int f, const RandomContext& random, int threads, bool directed=false){
+    CSRGraph flow_graph(graph);
+    parallelBlocks(graph.n,VERTEX_BLOCK,threads,[&](long long begin, long long end, long long block){
+        Philox gen=random.stream(FLOW_BLOCK_STREAMS+block);
+        uniform_int_distribution<> dis(1,f);
+        for(int u=begin;u<end;++u){
+            for(int e=graph.offsets[u];e<graph.offsets[u+1];++e){
+                int v=graph.targets[e];
+                if(directed){
+                    flow_graph.capacities[e]=dis(gen);
+                }
+                else if(u<v){
+                    int value=dis(gen);
+                    flow_graph.capacities[e]=value;
+                    flow_graph.capacities[graph.arc(v,u)]=value;
+                }
+            }
+        }
+    });
+    return flow_graph;
+}
+
+// Binary edge file: header {GRAPH_FILE_MAGIC, n, edge count} as 64-bit values, then the edges
+// as raw Edge records
+const uint64_t GRAPH_FILE_MAGIC=0x3248504152474B4FULL; // "OKGRAPH2"
+const long long STREAM_CHUNK=1<<22;
+
+// Stream a graph of generateCSRGraphParallel straight to a binary file. Partitions of the pair
+// space are sampled in batches of about STREAM_CHUNK edges and written in order, so memory stays
+// O(n+STREAM_CHUNK) whatever the edge count. With spanning_tree the file holds exactly the edges
+// of generateCSRGraphParallel for the same seed. Without it the components are joined by extra
+// edges at the end instead of replacing redundant ones. Returns the number of written edges.
+long long writeGraphStream(const string& filename, int n, float d, int r, int f, const RandomContext& random, int threads, bool spanning_tree=true, bool directed=false){
+    ofstream out(filename,ios::binary);
+    if(!out){
+        cerr << "Can not write graph file " << filename << endl;
+        return -1;
+    }
+    long long total=(long long)n*(n-1)/2;
+    long long rate=(long long)(double(d)*total);
+    uint64_t header[3]={GRAPH_FILE_MAGIC,uint64_t(n),0};
+    out.write(reinterpret_cast<const char*>(header),sizeof(header));
+
+    Philox gen=random.stream(GRAPH_STREAM);
+    vector<pair<int,int>> pending; // Pairs still waiting for their distance and capacity
+    vector<long long> tree;
+    if(spanning_tree && n>=2){
+        tree=randomTree(n,pending,gen);
+        rate-=n-1;
+    }
+    DisjointSets sets(spanning_tree?0:n);
+    long long written=0;
 
-    int n=flow_matrix.size();
+    // Edge blocks keep their numbers of generateCSRGraphParallel, only full blocks are written
+    // until the last call
+    auto flush=[&](bool last){
+        long long count=last?pending.size():pending.size()/EDGE_BLOCK*EDGE_BLOCK;
+        vector<Edge> edges(count);
+        long long first_block=written/EDGE_BLOCK;
+        parallelBlocks(count,EDGE_BLOCK,threads,[&](long long begin, long long end, long long block){
+            fillEdgeBlock(&pending[begin],&edges[begin],end-begin,r,f,directed,random.stream(EDGE_BLOCK_STREAMS+first_block+block));
+        });
+        out.write(reinterpret_cast<const char*>(edges.data()),count*sizeof(Edge));
+        pending.erase(pending.begin(),pending.begin()+count);
+        written+=count;
+    };
 
+    long long partitions=max(1LL,(total+PARTITION_PAIRS-1)/PARTITION_PAIRS);
+    PartitionSplitter split(total,rate,tree);
+    vector<long long> batch;
+    vector<long long> counts;
+    vector<vector<long long>> excluded;
+    long long batch_edges=0;
+    vector<long long> partition_excluded;
+    for(long long p=0;p<partitions;++p){
+        long long count=split.next(gen,partition_excluded);
+        if(count>0){
+            batch.push_back(p);
+            counts.push_back(count);
+            excluded.push_back(partition_excluded);
+            batch_edges+=count;
+        }
+        if(batch_edges<STREAM_CHUNK && p+1<partitions){
+            continue;
+        }
+        vector<vector<pair<int,int>>> parts(batch.size());
+        parallelBlocks(batch.size(),1,threads,[&](long long k, long long, long long){
+            long long lo=batch[k]*PARTITION_PAIRS;
+            Philox part_gen=random.stream(PAIR_BLOCK_STREAMS+batch[k]);
+            parts[k]=samplePairRange(n,lo,min(total,lo+PARTITION_PAIRS),counts[k],part_gen,excluded[k]);
+        });
+        for(auto& part : parts){
+            if(!spanning_tree){
+                for(auto [v1,v2] : part){
+                    sets.unite(v1,v2);
+                }
+            }
+            pending.insert(pending.end(),part.begin(),part.end());
+        }
+        batch.clear();
+        counts.clear();
+        excluded.clear();
+        batch_edges=0;
+        flush(false);
+    }
+    if(!spanning_tree){
+        vector<pair<int,int>> joining=joiningEdges(n,sets,gen);
+        pending.insert(pending.end(),joining.begin(),joining.end());
+    }
+    flush(true);
+
+    header[2]=written;
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(header),sizeof(header));
+    return written;
+}
+
+// Load a file of writeGraphStream into a CSR graph. The edges are read in chunks twice, once for
+// the degrees and once to place the arcs, so no edge list is held besides the graph itself.
+CSRGraph loadGraphStream(const string& filename){
+    CSRGraph g;
+    ifstream in(filename,ios::binary);
+    uint64_t header[3]={};
+    in.read(reinterpret_cast<char*>(header),sizeof(header));
+    if(!in || header[0]!=GRAPH_FILE_MAGIC){
+        cerr << "Invalid graph file " << filename << endl;
+        return g;
+    }
+    if(header[1]>uint64_t(numeric_limits<int>::max()) || header[2]>uint64_t(numeric_limits<int>::max())/2){
+        cerr << "Graph file " << filename << " has too many vertices or edges for int indices" << endl;
+        return g;
+    }
+    int n=header[1];
+    long long m=header[2];
+    vector<Edge> chunk;
+    // Returns false when the file ends early or holds an edge that is not between two
+    // different vertices below n
+    auto forEachEdge=[&](const function<void(const Edge&)>& body){
+        in.clear();
+        in.seekg(sizeof(header));
+        for(long long done=0;done<m;done+=chunk.size()){
+            chunk.resize(min<long long>(STREAM_CHUNK,m-done));
+            in.read(reinterpret_cast<char*>(chunk.data()),chunk.size()*sizeof(Edge));
+            if(in.gcount()!=streamsize(chunk.size()*sizeof(Edge))){
+                return false;
+            }
+            for(const Edge& e : chunk){
+                if(e.u<0 || e.u>=n || e.v<0 || e.v>=n || e.u==e.v){
+                    return false;
+                }
+                body(e);
+            }
+        }
+        return true;
+    };
+
+    g.n=n;
+    g.offsets.assign(n+1,0);
+    bool valid=forEachEdge([&](const Edge& e){
+        g.offsets[e.u+1]++;
+        g.offsets[e.v+1]++;
+    });
+    if(!valid){
+        cerr << "Invalid graph file " << filename << endl;
+        return CSRGraph();
+    }
     for(int i=0;i<n;++i){
-        for(int j=0;j<n;++j){
-            if(flow_matrix[i][j]!=0){
-                dotFile << "  " << i << " -> " << j << " [label=\"" << flow_matrix[i][j] << "\"]\n";
+        g.offsets[i+1]+=g.offsets[i];
+    }
+    g.targets.resize(2*m);
+    g.capacities.resize(2*m);
+    g.lengths.resize(2*m);
+    vector<int> pos(g.offsets.begin(),g.offsets.end()-1);
+    valid=forEachEdge([&](const Edge& e){
+        int slot=pos[e.u]++;
+        g.targets[slot]=e.v;
+        g.capacities[slot]=e.capacity;
+        g.lengths[slot]=e.length;
+        slot=pos[e.v]++;
+        g.targets[slot]=e.u;
+        g.capacities[slot]=e.back_capacity;
+        g.lengths[slot]=e.length;
+    });
+    if(!valid){
+        cerr << "Invalid graph file " << filename << endl;
+        return CSRGraph();
+    }
+
+    // Sort the arcs of every vertex by target, a repeated edge makes the file invalid
+    atomic<bool> repeated(false);
+    parallelBlocks(n,VERTEX_BLOCK,flow_threads,[&](long long begin, long long end, long long){
+        vector<array<int,3>> arcs;
+        for(int u=begin;u<end;++u){
+            arcs.clear();
+            for(int e=g.offsets[u];e<g.offsets[u+1];++e){
+                arcs.push_back({g.targets[e],g.capacities[e],g.lengths[e]});
+            }
+            sort(arcs.begin(),arcs.end());
+            for(int e=g.offsets[u];e<g.offsets[u+1];++e){
+                const auto& a=arcs[e-g.offsets[u]];
+                g.targets[e]=a[0];
+                g.capacities[e]=a[1];
+                g.lengths[e]=a[2];
+                if(e>g.offsets[u] && g.targets[e-1]==a[0]){
+                    repeated=true;
+                }
             }
         }
+    });
+    if(repeated){
+        cerr << "Invalid graph file " << filename << ", it repeats an edge" << endl;
+        return CSRGraph();
     }
+    return g;
+}
 
-    dotFile << "}\n";
-    dotFile.close();
+// CSR graph from vertex pairs of a benchmark family. Self loops and repeated pairs are dropped,
+// every edge gets a random distance in [1,r] and capacity in [1,f] like the uniform generator.
+CSRGraph buildRandomNetwork(int n, vector<pair<int,int>> pairs, int r, int f, Philox& gen){
+    for(auto& p : pairs){
+        if(p.first>p.second){
+            swap(p.first,p.second);
+        }
+    }
+    sort(pairs.begin(),pairs.end());
+    pairs.erase(unique(pairs.begin(),pairs.end()),pairs.end());
+    uniform_int_distribution<> dis(1,r);
+    uniform_int_distribution<> flow(1,f);
+    vector<Edge> edges;
+    edges.reserve(pairs.size());
+    for(auto [v1,v2] : pairs){
+        if(v1!=v2){
+            int length=dis(gen);
+            int capacity=flow(gen);
+            edges.push_back({v1,v2,length,capacity,capacity});
+        }
+    }
+    return buildCSR(n,edges);
+}
 
-    string command="dot -Tpng flow.dot -o " + filename;
-    system(command.c_str());
+// 2D grid, vertex (i,j) is i*cols+j and is joined to its right and lower neighbour
+CSRGraph generateGrid2D(int rows, int cols, int r, int f, Philox& gen){
+    vector<pair<int,int>> pairs;
+    for(int i=0;i<rows;++i){
+        for(int j=0;j<cols;++j){
+            int v=i*cols+j;
+            if(j+1<cols){
+                pairs.push_back({v,v+1});
+            }
+            if(i+1<rows){
+                pairs.push_back({v,v+cols});
+            }
+        }
+    }
+    return buildRandomNetwork(rows*cols,pairs,r,f,gen);
+}
+
+// 3D grid, vertex (i,j,k) is (i*y+j)*z+k
+CSRGraph generateGrid3D(int x, int y, int z, int r, int f, Philox& gen){
+    vector<pair<int,int>> pairs;
+    for(int i=0;i<x;++i){
+        for(int j=0;j<y;++j){
+            for(int k=0;k<z;++k){
+                int v=(i*y+j)*z+k;
+                if(k+1<z){
+                    pairs.push_back({v,v+1});
+                }
+                if(j+1<y){
+                    pairs.push_back({v,v+z});
+                }
+                if(i+1<x){
+                    pairs.push_back({v,v+y*z});
+                }
+            }
+        }
+    }
+    return buildRandomNetwork(x*y*z,pairs,r,f,gen);
+}
+
+// Layered network: every vertex of a layer is joined to degree distinct random vertices of the
+// next layer. Layer l holds vertices l*width..(l+1)*width-1. Not necessarily connected.
+CSRGraph generateLayered(int layers, int width, int degree, int r, int f, Philox& gen){
+    degree=max(1,min(degree,width));
+    vector<pair<int,int>> pairs;
+    vector<int> picked;
+    for(int l=0;l+1<layers;++l){
+        for(int i=0;i<width;++i){
+            // Floyd's sampling of degree distinct positions in the next layer
+            picked.clear();
+            for(int j=width-degree;j<width;++j){
+                int t=uniform_int_distribution<>(0,j)(gen);
+                picked.push_back(find(picked.begin(),picked.end(),t)==picked.end()?t:j);
+            }
+            for(int t : picked){
+                pairs.push_back({l*width+i,(l+1)*width+t});
+            }
+        }
+    }
+    return buildRandomNetwork(layers*width,pairs,r,f,gen);
+}
+
+// Barabasi-Albert scale-free graph: starts from a clique of m+1 vertices, every new vertex is
+// joined to m distinct vertices picked with probability proportional to their degree
+CSRGraph generateBarabasiAlbert(int n, int m, int r, int f, Philox& gen){
+    m=max(1,min(m,n-1));
+    vector<pair<int,int>> pairs;
+    vector<int> ends; // Both endpoints of every edge, so a uniform pick follows the degrees
+    for(int i=0;i<=m && i<n;++i){
+        for(int j=0;j<i;++j){
+            pairs.push_back({j,i});
+            ends.push_back(i);
+            ends.push_back(j);
+        }
+    }
+    vector<int> targets;
+    for(int v=m+1;v<n;++v){
+        targets.clear();
+        while((int)targets.size()<m){
+            int t=ends[uniform_int_distribution<size_t>(0,ends.size()-1)(gen)];
+            if(find(targets.begin(),targets.end(),t)==targets.end()){
+                targets.push_back(t);
+            }
+        }
+        for(int t : targets){
+            pairs.push_back({t,v});
+            ends.push_back(t);
+            ends.push_back(v);
+        }
+    }
+    return buildRandomNetwork(n,pairs,r,f,gen);
+}
+
+// R-MAT graph, a stochastic Kronecker graph with a 2x2 initiator: every edge picks one quadrant
+// of the adjacency matrix per bit with probabilities a, b, c and 1-a-b-c. Has 2^scale vertices,
+// repeated edges and self loops are dropped, so it is not necessarily connected.
+CSRGraph generateRMAT(int scale, long long edges, int r, int f, Philox& gen, double a=0.57, double b=0.19, double c=0.19){
+    uniform_real_distribution<> quadrant(0.0,1.0);
+    vector<pair<int,int>> pairs;
+    pairs.reserve(edges);
+    for(long long k=0;k<edges;++k){
+        int u=0;
+        int v=0;
+        for(int bit=0;bit<scale;++bit){
+            double p=quadrant(gen);
+            u=2*u+(p>=a+b);
+            v=2*v+((p>=a && p<a+b) || p>=a+b+c);
+        }
+        pairs.push_back({u,v});
+    }
+    return buildRandomNetwork(1<<scale,pairs,r,f,gen);
+}
+
+// Many-phase case for augmenting path solvers, meant for source 0 and sink 1, which are joined
+// by k disjoint paths of lengths 1..k. Every path has its own length, so Edmonds-Karp and Dinic
+// need k BFS phases over the whole network, O(V^1.5) work for V=O(k^2) vertices. This is a
+// stress test for per-phase costs, not one of the known worst-case families.
+CSRGraph generateAugmentingPathBadCase(int k, int r, int f, Philox& gen){
+    vector<pair<int,int>> pairs;
+    int n=2;
+    for(int length=1;length<=k;++length){
+        int previous=0;
+        for(int step=1;step<length;++step){
+            pairs.push_back({previous,n});
+            previous=n++;
+        }
+        pairs.push_back({previous,1});
+    }
+    return buildRandomNetwork(n,pairs,r,f,gen);
 }
 
-bool bfs(const vector<vector<int>>& residual, vector<int>& parent, int source, int sink){
-    int n=residual.size();
-    vector<bool> visited(n,false);
+// Graph of the chosen family with about n vertices and a density close to d. Families that do
+// not take n directly round it to their own shape, so the result can have a few more or fewer vertices.
+// With directed the capacity of every direction is drawn on its own.
+CSRGraph generateFamily(const string& family, int n, float d, int r, int f, const RandomContext& random, int threads, bool spanning_tree, bool directed=false){
+    if(directed && family!="uniform"){
+        return generateFlowParallel(generateFamily(family,n,d,r,f,random,threads,spanning_tree),f,random,threads,true);
+    }
+    Philox gen=random.stream(GRAPH_STREAM);
+    double average_degree=max(1.0,double(d)*(n-1));
+    if(family=="grid2d"){
+        int side=max(1,int(round(sqrt(n))));
+        return generateGrid2D(side,(n+side-1)/side,r,f,gen);
+    }
+    if(family=="grid3d"){
+        int side=max(1,int(round(cbrt(n))));
+        return generateGrid3D(side,side,(n+side*side-1)/(side*side),r,f,gen);
+    }
+    if(family=="layered"){
+        int width=max(1,int(round(sqrt(n))));
+        return generateLayered((n+width-1)/width,width,int(round(d*width)),r,f,gen);
+    }
+    if(family=="barabasi_albert"){
+        return generateBarabasiAlbert(n,int(round(average_degree/2)),r,f,gen);
+    }
+    if(family=="rmat"){
+        int scale=max(1,int(ceil(log2(n))));
+        return generateRMAT(scale,(long long)(average_degree*n/2),r,f,gen);
+    }
+    if(family=="bad_case"){
+        return generateAugmentingPathBadCase(max(1,int(round(sqrt(2.0*n)))),r,f,gen);
+    }
+    if(family=="uniform"){
+        return generateCSRGraphParallel(n,d,r,random,threads,spanning_tree,f,directed);
+    }
+    cerr << "Invalid graph family." << endl;
+    return CSRGraph();
+}
+
+// Create an image of a flow matrix
+template<class M>
+void generateFlowImage(const M& flow, const string& filename){
+    auto snapshot=make_shared<const M>(flow);
+    submitRender([snapshot,filename](){
+        renderDrawing(flowDrawing(*snapshot),filename);
+    });
+}
+
+// Residual network in CSR form, rev[e] is the index of the reverse twin of arc e
+struct ResidualNetwork{
+    int n=0;
+    vector<int> first;    // Arcs of vertex v are first[v]..first[v+1]-1
+    vector<int> to;       // Head of every arc
+    vector<int> rev;      // Reverse twin of every arc
+    vector<int> capacity; // Original capacity of every arc
+    vector<int> residual; // Remaining capacity of every arc
+
+    int arcs() const{
+        return to.size();
+    }
+    // Flow pushed through arc e, negative on the reverse twin of a used arc
+    int flow(int e) const{
+        return capacity[e]-residual[e];
+    }
+    // Drop all flow and start again from the original capacities
+    void reset(){
+        residual=capacity;
+    }
+};
+
+// Arc indices of the network are the same as in the CSR graph
+ResidualNetwork buildResidual(const CSRGraph& g){
+    ResidualNetwork net;
+    net.n=g.n;
+    net.first=g.offsets;
+    net.to=g.targets;
+    net.capacity=g.capacities;
+    net.residual=g.capacities;
+    net.rev.resize(g.targets.size());
+    for(int u=0;u<g.n;++u){
+        for(int e=g.offsets[u];e<g.offsets[u+1];++e){
+            net.rev[e]=g.arc(g.targets[e],u);
+        }
+    }
+    return net;
+}
+
+// BFS over arcs with remaining capacity, parent_arc[v] is the arc used to reach v
+bool bfs(const ResidualNetwork& net, vector<int>& parent_arc, int source, int sink){
+    vector<bool> visited(net.n,false);
     queue<int> q;
     q.push(source);
     visited[source]=true;
-    parent[source]=-1;
+    parent_arc[source]=-1;
     while(!q.empty()){
         int u=q.front();
         q.pop();
-        for(int v=0;v<n;++v){
-            if(!visited[v] && residual[u][v]>0){
+        for(int e=net.first[u];e<net.first[u+1];++e){
+            int v=net.to[e];
+            if(!visited[v] && net.residual[e]>0){
                 q.push(v);
-                parent[v]=u;
+                parent_arc[v]=e;
                 visited[v]=true;
                 if (v==sink)
                     return true;
@@ -168,127 +1435,764 @@ bool bfs(const vector<vector<int>>& residual, vector<int>& parent, int source, i
     return false;
 }
 
-void generateKarpImage(const vector<vector<int>>& flow_matrix, const vector<vector<int>>& residual, const string& filename, int iteration){
-    ofstream dotFile("karp.dot");
-    dotFile << "digraph G {\n";
-
-    int n=flow_matrix.size();
-
-    for(int i=0;i<n;++i){
-        for(int j=0;j<n;++j){
-            if(flow_matrix[i][j]!=0){
-                dotFile << "  " << i << " -> " << j << " [label=\"" << flow_matrix[i][j] << ", " << flow_matrix[i][j]-residual[i][j] << "\", ";
-                // Add color for used paths
-                if (residual[i][j] != flow_matrix[i][j]){
-                    dotFile << "color=\"red\"";
-                }
-                dotFile << "]\n";
+// Arcs with capacity labeled "capacity, flow", arcs carrying flow in red
+Drawing residualDrawing(const ResidualNetwork& net){
+    Drawing drawing;
+    drawing.n=net.n;
+    drawing.directed=true;
+    for(int i=0;i<net.n;++i){
+        for(int e=net.first[i];e<net.first[i+1];++e){
+            if(net.capacity[e]!=0){
+                drawing.edges.push_back({i,net.to[e],to_string(net.capacity[e])+", "+to_string(net.flow(e)),net.residual[e]!=net.capacity[e]});
             }
         }
     }
+    return drawing;
+}
 
-    dotFile << "}\n";
-    dotFile.close();
+// Layout of the residual views. It is computed once from every arc of a network, also the
+// disabled ones, and kept while later networks have the same arcs, so vertices stay in place
+// from one image to the next.
+shared_ptr<const vector<pair<double,double>>> residualLayout(const ResidualNetwork& net){
+    static mutex lock;
+    static vector<int> first;
+    static vector<int> to;
+    static shared_ptr<const vector<pair<double,double>>> layout;
+    lock_guard<mutex> guard(lock);
+    if(!layout || first!=net.first || to!=net.to){
+        Drawing arcs;
+        arcs.n=net.n;
+        arcs.directed=true;
+        for(int u=0;u<net.n;++u){
+            for(int e=net.first[u];e<net.first[u+1];++e){
+                arcs.edges.push_back({u,net.to[e],""});
+            }
+        }
+        layout=make_shared<const vector<pair<double,double>>>(forceLayout(arcs));
+        first=net.first;
+        to=net.to;
+    }
+    return layout;
+}
 
-    string command = "dot -Tpng karp.dot -o "+filename+to_string(iteration)+".png";
-    system(command.c_str());
+void generateKarpImage(const ResidualNetwork& residual, const string& filename, int iteration){
+    // Only the arrays drawn are copied, the solver may change the network right after
+    auto snapshot=make_shared<ResidualNetwork>();
+    snapshot->n=residual.n;
+    snapshot->first=residual.first;
+    snapshot->to=residual.to;
+    snapshot->capacity=residual.capacity;
+    snapshot->residual=residual.residual;
+    string image=filename+to_string(iteration)+"."+image_format;
+    submitRender([snapshot,image](){
+        shared_ptr<const vector<pair<double,double>>> layout;
+        if(isSVG(image)){
+            layout=residualLayout(*snapshot);
+        }
+        renderDrawing(residualDrawing(*snapshot),image,layout.get());
+    });
 }
 
-int edmonds_karp(const vector<vector<int>>& flow_matrix, int source, int sink, int iteration=-1){
-    int n=flow_matrix.size();
-    vector<vector<int>> residual(flow_matrix);
+// Trace of a run in one JSON lines file instead of an image per solve. The first line holds the
+// shared layout and every arc as [from,to,capacity], every further line one recorded state as
+// {"iteration", "capacity", "residual"} with only the [arc,value] pairs that changed since the
+// state before, starting from the network without flow. A network with other arcs starts a new
+// header line. Records are expected one at a time, like flow_observer calls.
+struct FlowTrace{
+    ofstream out;
+    vector<int> first; // Arc table of the last header
+    vector<int> to;
+    vector<int> capacity; // Capacities of the last recorded state
+    vector<int> residual; // Residual capacities of the last recorded state
+
+    FlowTrace(const string& filename): out(filename){}
+
+    void record(const ResidualNetwork& net, int iteration){
+        if(first!=net.first || to!=net.to){
+            json header;
+            header["n"]=net.n;
+            header["layout"]=json::array();
+            for(auto [px,py] : *residualLayout(net)){
+                header["layout"].push_back({round(px*1000)/1000,round(py*1000)/1000});
+            }
+            header["arcs"]=json::array();
+            for(int u=0;u<net.n;++u){
+                for(int e=net.first[u];e<net.first[u+1];++e){
+                    header["arcs"].push_back({u,net.to[e],net.capacity[e]});
+                }
+            }
+            out << header.dump() << "\n";
+            first=net.first;
+            to=net.to;
+            capacity=net.capacity;
+            residual=net.capacity;
+        }
+        json step;
+        step["iteration"]=iteration;
+        step["capacity"]=json::array();
+        step["residual"]=json::array();
+        for(int e=0;e<net.arcs();++e){
+            if(net.capacity[e]!=capacity[e]){
+                step["capacity"].push_back({e,net.capacity[e]});
+                capacity[e]=net.capacity[e];
+            }
+            if(net.residual[e]!=residual[e]){
+                step["residual"].push_back({e,net.residual[e]});
+                residual[e]=net.residual[e];
+            }
+        }
+        out << step.dump() << "\n";
+    }
+};
 
+// Augment the network from its current residual state, returns the added flow.
+// With undo every changed arc is logged with its previous residual capacity.
+// Augmenting stops as soon as the added flow reaches limit.
+int edmonds_karp(ResidualNetwork& net, int source, int sink, vector<pair<int,int>>* undo=nullptr, int limit=numeric_limits<int>::max()){
     int max_flow=0;
-    vector<int> parent(n);
+    vector<int> parent_arc(net.n);
 
-    while (bfs(residual,parent,source,sink)){
-        int path_flow=numeric_limits<int>::max();
+    while (max_flow<limit && bfs(net,parent_arc,source,sink)){
+        int path_flow=limit-max_flow;
 
         // Find the minimum capacity along the path
-        for(int v=sink;v!=source;v=parent[v]){
-            int u=parent[v];
-            path_flow=min(path_flow,residual[u][v]);
+        for(int v=sink;v!=source;v=net.to[net.rev[parent_arc[v]]]){
+            path_flow=min(path_flow,net.residual[parent_arc[v]]);
         }
 
         // Update the residual graph and flow
-        for(int v= sink;v!=source;v=parent[v]){
-            int u=parent[v];
-            residual[u][v]-=path_flow;
-            residual[v][u]+=path_flow;
-		}
+        for(int v=sink;v!=source;v=net.to[net.rev[parent_arc[v]]]){
+            int e=parent_arc[v];
+            if(undo){
+                undo->push_back({e,net.residual[e]});
+                undo->push_back({net.rev[e],net.residual[net.rev[e]]});
+            }
+            net.residual[e]-=path_flow;
+            net.residual[net.rev[e]]+=path_flow;
+        }
         max_flow+=path_flow;
     }
+    return max_flow;
+}
+
+// Level graph from the source, returns false when the sink is not reachable
+bool bfs_levels(const ResidualNetwork& net, vector<int>& level, int source, int sink){
+    fill(level.begin(),level.end(),-1);
+    queue<int> q;
+    q.push(source);
+    level[source]=0;
+    while(!q.empty()){
+        int u=q.front();
+        q.pop();
+        for(int e=net.first[u];e<net.first[u+1];++e){
+            int v=net.to[e];
+            if(level[v]<0 && net.residual[e]>0){
+                level[v]=level[u]+1;
+                q.push(v);
+            }
+        }
+    }
+    return level[sink]>=0;
+}
+
+// Dinic's algorithm: blocking flows on level graphs, current[v] is the next arc of v to try.
+// Stops as soon as the added flow reaches limit.
+int dinic(ResidualNetwork& net, int source, int sink, int limit=numeric_limits<int>::max()){
+    int max_flow=0;
+    vector<int> level(net.n);
+    vector<int> current(net.n);
+    vector<int> path; // Arcs from the source to u
+
+    while(max_flow<limit && bfs_levels(net,level,source,sink)){
+        copy(net.first.begin(),net.first.end()-1,current.begin());
+        path.clear();
+        int u=source;
+        while(true){
+            if(u==sink){
+                int path_flow=limit-max_flow;
+                for(int e : path){
+                    path_flow=min(path_flow,net.residual[e]);
+                }
+                for(int e : path){
+                    net.residual[e]-=path_flow;
+                    net.residual[net.rev[e]]+=path_flow;
+                }
+                max_flow+=path_flow;
+                if(max_flow==limit){
+                    break;
+                }
+                // Continue from the tail of the first saturated arc
+                int k=0;
+                while(net.residual[path[k]]>0){
+                    k++;
+                }
+                u=net.to[net.rev[path[k]]];
+                path.resize(k);
+                continue;
+            }
+            // Advance along the first admissible arc
+            int& e=current[u];
+            while(e<net.first[u+1] && (net.residual[e]==0 || level[net.to[e]]!=level[u]+1)){
+                e++;
+            }
+            if(e<net.first[u+1]){
+                path.push_back(e);
+                u=net.to[e];
+                continue;
+            }
+            // Dead end, retreat and skip the arc that led here
+            if(u==source){
+                break;
+            }
+            int back=path.back();
+            path.pop_back();
+            u=net.to[net.rev[back]];
+            current[u]++;
+        }
+    }
+    return max_flow;
+}
+
+// Exact distances to target over residual arcs that avoid excluded,
+// vertices that can not reach target this way get height n
+void global_relabel(const ResidualNetwork& net, vector<int>& height, int excluded, int target){
+    fill(height.begin(),height.end(),net.n);
+    queue<int> q;
+    q.push(target);
+    height[target]=0;
+    while(!q.empty()){
+        int u=q.front();
+        q.pop();
+        for(int e=net.first[u];e<net.first[u+1];++e){
+            int v=net.to[e];
+            if(height[v]==net.n && v!=excluded && net.residual[net.rev[e]]>0){
+                height[v]=height[u]+1;
+                q.push(v);
+            }
+        }
+    }
+}
+
+// Highest-label discharge of every active vertex towards target, excluded never becomes active.
+// Vertices whose height reaches n can not reach target and keep their excess.
+void push_relabel_phase(ResidualNetwork& net, vector<int>& excess, int excluded, int target){
+    int n=net.n;
+    vector<int> height(n);
+    vector<int> current(net.first.begin(),net.first.end()-1);
+    vector<int> count(n+1,0);          // Vertices per height below n, for the gap heuristic
+    vector<vector<int>> active(n);     // Bucket queue of active vertices per height
+    int highest=-1;
+    int relabels=0;
+
+    auto rebuild=[&](){
+        global_relabel(net,height,excluded,target);
+        fill(count.begin(),count.end(),0);
+        for(auto& bucket : active){
+            bucket.clear();
+        }
+        highest=-1;
+        for(int v=0;v<n;++v){
+            if(height[v]<n){
+                count[height[v]]++;
+                if(excess[v]>0 && v!=excluded && v!=target){
+                    active[height[v]].push_back(v);
+                    highest=max(highest,height[v]);
+                }
+            }
+        }
+        relabels=0;
+    };
+    rebuild();
+
+    while(highest>=0){
+        if(active[highest].empty()){
+            highest--;
+            continue;
+        }
+        int u=active[highest].back();
+        active[highest].pop_back();
+        if(height[u]!=highest || excess[u]==0){
+            continue; // Stale entry left by a gap or a global relabel
+        }
+
+        // Discharge u
+        while(excess[u]>0 && height[u]<n){
+            int& e=current[u];
+            if(e==net.first[u+1]){
+                // Relabel
+                int old=height[u];
+                int new_height=2*n;
+                for(int a=net.first[u];a<net.first[u+1];++a){
+                    if(net.residual[a]>0){
+                        new_height=min(new_height,height[net.to[a]]+1);
+                    }
+                }
+                count[old]--;
+                height[u]=min(new_height,n);
+                if(height[u]<n){
+                    count[height[u]]++;
+                }
+                e=net.first[u];
+                relabels++;
+                // Gap heuristic: nothing above an empty height can reach target any more
+                if(count[old]==0){
+                    for(int v=0;v<n;++v){
+                        if(height[v]>old && height[v]<n){
+                            count[height[v]]--;
+                            height[v]=n;
+                        }
+                    }
+                }
+                continue;
+            }
+            int v=net.to[e];
+            if(net.residual[e]>0 && height[u]==height[v]+1){
+                int pushed=min(excess[u],net.residual[e]);
+                net.residual[e]-=pushed;
+                net.residual[net.rev[e]]+=pushed;
+                excess[u]-=pushed;
+                if(excess[v]==0 && v!=excluded && v!=target){
+                    active[height[v]].push_back(v);
+                    highest=max(highest,height[v]);
+                }
+                excess[v]+=pushed;
+            }
+            else{
+                e++;
+            }
+        }
+
+        // Periodic global relabel keeps heights exact
+        if(relabels>=n){
+            rebuild();
+        }
+    }
+}
+
+// Highest-label push-relabel with gap and global relabel heuristics,
+// augments the network from its current residual state and returns the added flow.
+// A limit acts as a virtual arc of that capacity into the source: the source starts
+// with limit excess and is discharged like any other vertex.
+int pushRelabelMaxFlow(ResidualNetwork& net, int source, int sink, int limit=numeric_limits<int>::max()){
+    vector<int> excess(net.n,0);
+    bool bounded=limit<numeric_limits<int>::max();
+
+    if(bounded){
+        excess[source]=limit;
+    }
+    else{
+        // Saturate every arc leaving the source
+        for(int e=net.first[source];e<net.first[source+1];++e){
+            if(net.residual[e]>0){
+                excess[net.to[e]]+=net.residual[e];
+                net.residual[net.rev[e]]+=net.residual[e];
+                net.residual[e]=0;
+            }
+        }
+    }
+
+    // Phase 1 builds a maximum preflow, phase 2 returns the leftover excess to the source
+    push_relabel_phase(net,excess,bounded?-1:source,sink);
+    push_relabel_phase(net,excess,sink,source);
+    return excess[sink];
+}
+
+// Reusable barrier for a fixed number of threads
+struct Barrier{
+    mutex lock;
+    condition_variable released;
+    int count;
+    int waiting=0;
+    long long generation=0;
+
+    Barrier(int count): count(count){}
+    void wait(){
+        unique_lock<mutex> guard(lock);
+        long long current=generation;
+        if(++waiting==count){
+            waiting=0;
+            generation++;
+            released.notify_all();
+        }
+        else{
+            released.wait(guard,[&](){
+                return generation!=current;
+            });
+        }
+    }
+};
+
+// Frontiers smaller than this are expanded by one thread, splitting them costs more than it saves
+const size_t RELABEL_SEQUENTIAL_FRONTIER=1<<12;
+// Phases with fewer active vertices are left to the sequential push-relabel
+const int PARALLEL_MIN_ACTIVE=1<<10;
+
+// Lock-free parallel push-relabel (Hong's algorithm). A vertex belongs to the thread that
+// raised its excess from 0, only that thread pushes from it or relabels it, so residual
+// capacities, excesses and heights only need atomic updates. Threads work on their own
+// queues until enough relabels were done, then heights are recomputed by a parallel BFS.
+// Once too few vertices are active the sequential first phase finishes the preflow, and
+// leftover excess is returned to the source by the sequential second phase.
+// A limit is handled like in pushRelabelMaxFlow.
+int parallelPushRelabelMaxFlow(ResidualNetwork& net, int source, int sink, int threads, int limit=numeric_limits<int>::max()){
+    int n=net.n;
+    int m=net.arcs();
+    threads=max(threads,1);
+    bool bounded=limit<numeric_limits<int>::max();
+    int excluded=bounded?-1:source; // Vertex that never becomes active
+    vector<atomic<int>> residual(m);
+    vector<atomic<int>> excess(n);
+    vector<atomic<int>> height(n);
+    for(int e=0;e<m;++e){
+        residual[e].store(net.residual[e],memory_order_relaxed);
+    }
+    for(int v=0;v<n;++v){
+        excess[v].store(0,memory_order_relaxed);
+    }
+
+    if(bounded){
+        excess[source].store(limit,memory_order_relaxed);
+    }
+    else{
+        // Saturate every arc leaving the source
+        for(int e=net.first[source];e<net.first[source+1];++e){
+            int c=residual[e].load(memory_order_relaxed);
+            if(c>0){
+                excess[net.to[e]].fetch_add(c,memory_order_relaxed);
+                residual[net.rev[e]].fetch_add(c,memory_order_relaxed);
+                residual[e].store(0,memory_order_relaxed);
+            }
+        }
+    }
+
+    // Threads live for the whole solve and meet at barriers. A phase starts with a global
+    // relabel, a level-synchronous BFS from the sink. Levels with a small frontier are expanded
+    // by thread 0 alone, bigger ones are split between the threads. Then every thread
+    // discharges its share of the active vertices.
+    Barrier barrier(threads);
+    vector<int> frontier;
+    vector<int> sequential_next;
+    vector<vector<int>> next(threads);
+    vector<vector<int>> queues(threads);
+    int level=0;
+    int active=0;
+    atomic<int> relabels(0);
+    auto expand=[&](size_t first, size_t step, vector<int>& out){
+        for(size_t k=first;k<frontier.size();k+=step){
+            int u=frontier[k];
+            for(int e=net.first[u];e<net.first[u+1];++e){
+                int v=net.to[e];
+                int unseen=n;
+                if(v!=excluded && residual[net.rev[e]].load(memory_order_relaxed)>0
+                   && height[v].compare_exchange_strong(unseen,level+1,memory_order_relaxed)){
+                    out.push_back(v);
+                }
+            }
+        }
+    };
+    auto worker=[&](int t){
+        while(true){
+            if(t==0){
+                for(int v=0;v<n;++v){
+                    height[v].store(n,memory_order_relaxed);
+                }
+                height[sink].store(0,memory_order_relaxed);
+                frontier={sink};
+                level=0;
+            }
+            while(true){
+                if(t==0){
+                    while(!frontier.empty() && frontier.size()<RELABEL_SEQUENTIAL_FRONTIER){
+                        sequential_next.clear();
+                        expand(0,1,sequential_next);
+                        frontier.swap(sequential_next);
+                        level++;
+                    }
+                }
+                barrier.wait();
+                if(frontier.empty()){
+                    break;
+                }
+                expand(t,threads,next[t]);
+                barrier.wait();
+                if(t==0){
+                    frontier.clear();
+                    for(auto& part : next){
+                        frontier.insert(frontier.end(),part.begin(),part.end());
+                        part.clear();
+                    }
+                    level++;
+                }
+            }
+
+            if(t==0){
+                active=0;
+                relabels.store(0,memory_order_relaxed);
+                for(auto& queue : queues){
+                    queue.clear();
+                }
+                for(int v=0;v<n;++v){
+                    if(v!=excluded && v!=sink && excess[v].load(memory_order_relaxed)>0 && height[v].load(memory_order_relaxed)<n){
+                        queues[active++%threads].push_back(v);
+                    }
+                }
+                if(active<PARALLEL_MIN_ACTIVE){
+                    active=0;
+                }
+            }
+            barrier.wait();
+            if(active==0){
+                return;
+            }
+            vector<int>& work=queues[t];
+            vector<int> left; // Vertices still owned when the phase ends
+            while(!work.empty()){
+                int u=work.back();
+                work.pop_back();
+                if(relabels.load(memory_order_relaxed)>=n){
+                    left.push_back(u);
+                    continue;
+                }
+                while(true){
+                    int h=height[u].load(memory_order_relaxed);
+                    if(h>=n){
+                        break; // Can not reach the sink, keep the excess for phase 2
+                    }
+                    // Find the lowest neighbour over a residual arc
+                    int best=-1;
+                    int best_height=numeric_limits<int>::max();
+                    for(int e=net.first[u];e<net.first[u+1];++e){
+                        if(residual[e].load(memory_order_relaxed)>0){
+                            int hv=height[net.to[e]].load(memory_order_relaxed);
+                            if(hv<best_height){
+                                best_height=hv;
+                                best=e;
+                            }
+                        }
+                    }
+                    if(best==-1){
+                        height[u].store(n,memory_order_relaxed);
+                        break;
+                    }
+                    if(h>best_height){
+                        int v=net.to[best];
+                        int pushed=min(excess[u].load(memory_order_acquire),residual[best].load(memory_order_relaxed));
+                        residual[best].fetch_sub(pushed,memory_order_relaxed);
+                        residual[net.rev[best]].fetch_add(pushed,memory_order_relaxed);
+                        int left_excess=excess[u].fetch_sub(pushed,memory_order_acq_rel)-pushed;
+                        if(excess[v].fetch_add(pushed,memory_order_acq_rel)==0 && v!=excluded && v!=sink){
+                            work.push_back(v);
+                        }
+                        if(left_excess==0){
+                            break; // u is released, another thread may own it now
+                        }
+                    }
+                    else{
+                        height[u].store(min(best_height+1,n),memory_order_relaxed);
+                        relabels.fetch_add(1,memory_order_relaxed);
+                    }
+                }
+            }
+            work.swap(left);
+            barrier.wait();
+        }
+    };
+    vector<thread> pool;
+    for(int t=1;t<threads;++t){
+        pool.emplace_back(worker,t);
+    }
+    worker(0);
+    for(thread& th : pool){
+        th.join();
+    }
+
+    for(int e=0;e<m;++e){
+        net.residual[e]=residual[e].load(memory_order_relaxed);
+    }
+    vector<int> final_excess(n);
+    for(int v=0;v<n;++v){
+        final_excess[v]=excess[v].load(memory_order_relaxed);
+    }
+    push_relabel_phase(net,final_excess,excluded,sink);
+    push_relabel_phase(net,final_excess,sink,source);
+    return final_excess[sink];
+}
+
+// Observer of solved networks, called with the residual network and its image number after every
+// solve that added flow. Empty by default so solvers do no I/O, set it to trace or draw a run.
+// It is always called from the solving thread, candidates are reported in arc order.
+function<void(const ResidualNetwork&,int)> flow_observer;
+
+// Run the selected max flow method. It continues from the flow already held by net, so a
+// feasible flow left by an earlier call is a warm start. With a limit the solver stops once
+// the added flow reaches it. Returns the added flow, -1 for an unknown method
+int find_max_flow(ResidualNetwork& net, int source, int sink, const string& finding_method, int iteration=-1, int limit=numeric_limits<int>::max()){
+    int max_flow;
+    if(finding_method=="edmonds_karp"){
+        max_flow=edmonds_karp(net,source,sink,nullptr,limit);
+    }
+    else if(finding_method=="dinic"){
+        max_flow=dinic(net,source,sink,limit);
+    }
+    else if(finding_method=="pushRelabelMaxFlow"){
+        max_flow=pushRelabelMaxFlow(net,source,sink,limit);
+    }
+    else if(finding_method=="parallelPushRelabel"){
+        max_flow=parallelPushRelabelMaxFlow(net,source,sink,flow_threads,limit);
+    }
+    else{
+        return -1;
+    }
 
-    // Generate graphical representation of the residual flow matrix
-    if(max_flow>0){
-    	generateKarpImage(flow_matrix,residual,"karp", iteration);
-    	//printMatrix(residual);
-    }	
-    
+    if(max_flow>0 && flow_observer){
+        flow_observer(net,iteration);
+    }
     return max_flow;
 }
 
-vector<vector<float>> finding_single_connections(const vector<vector<int>>& graph,const vector<vector<int>>& flow_matrix, int source, int sink, const string finding_method, vector<int> iff = {}, int iff1=0){
-	int n=flow_matrix.size();
+// Enable or disable both arcs of edge (u,v) in a work network, each keeps its own capacity
+void setEdgeCapacity(ResidualNetwork& work, const CSRGraph& g, int u, int v, bool enabled){
+    int uv=g.arc(u,v);
+    int vu=g.arc(v,u);
+    work.capacity[uv]=enabled?g.capacities[uv]:0;
+    work.capacity[vu]=enabled?g.capacities[vu]:0;
+}
+
+// Enable a disabled edge (u,v) without dropping the flow already in net
+void enableEdge(ResidualNetwork& net, const CSRGraph& g, int u, int v){
+    for(int a : {g.arc(u,v),g.arc(v,u)}){
+        if(net.capacity[a]==0){
+            net.capacity[a]=g.capacities[a];
+            net.residual[a]+=g.capacities[a];
+        }
+    }
+}
+
+// Incremental max flow: net holds a maximum flow without edge (u,v), so after enabling
+// the edge only paths through its arcs can add flow. Changed arcs are logged in undo.
+int add_edge_flow(ResidualNetwork& net, const CSRGraph& g, int source, int sink, int u, int v, vector<pair<int,int>>& undo){
+    undo.push_back({g.arc(u,v),net.residual[g.arc(u,v)]});
+    undo.push_back({g.arc(v,u),net.residual[g.arc(v,u)]});
+    enableEdge(net,g,u,v);
+    return edmonds_karp(net,source,sink,&undo);
+}
+
+// Restore the residual capacities logged by add_edge_flow
+void rollback(ResidualNetwork& net, vector<pair<int,int>>& undo){
+    for(auto it=undo.rbegin();it!=undo.rend();++it){
+        net.residual[it->first]=it->second;
+    }
+    undo.clear();
+}
+
+vector<vector<float>> finding_single_connections(const CSRGraph& g, int source, int sink, const string finding_method, vector<int> iff = {}, int iff1=0){
+	int n=g.n;
 	vector<vector<float>> possible_edges(n,vector<float>(4,0));
-	vector<vector<int>> work_matrix(flow_matrix);
+	ResidualNetwork work=buildResidual(g);
 	int j=0;
-	
-	for(int i=0;i<n;++i){
-		auto ifff=find(iff.begin(), iff.end(), i);
-		if(ifff==iff.end()){
-			work_matrix[sink][i]=0;
-			work_matrix[i][sink]=0;
+
+	// Only real neighbours of the sink can become new connections
+	for(int e=g.offsets[sink];e<g.offsets[sink+1];++e){
+		int i=g.targets[e];
+		if(find(iff.begin(), iff.end(), i)==iff.end()){
+			setEdgeCapacity(work,g,sink,i,false);
+		}
+	}
+	// Maximum flow of the base network, every candidate starts from it
+	work.reset();
+	int base_flow=find_max_flow(work,source,sink,finding_method,x);
+	x++;
+	if(base_flow<0){
+		cerr << "Invalid flow finding method." << endl;
+		return {};
+	}
+	// Candidates are independent, evaluate them in parallel on scratch copies of the base network.
+	// Results and image numbers follow the arc order, so the output does not depend on timing.
+	int first=g.offsets[sink];
+	int candidates=g.degree(sink);
+	vector<int> flows(candidates,base_flow);
+	vector<int> iterations(candidates,-1);
+	for(int k=0;k<candidates;++k){
+		if(find(iff.begin(), iff.end(), g.targets[first+k])==iff.end()){
+			iterations[k]=x;
+			x++;
 		}
 	}
-	//printMatrix(work_matrix);
-	//cout << "^ fsc1" << endl;
-	for(int i=0;i<n;++i){
-		work_matrix[sink][i]=flow_matrix[sink][i];
-		work_matrix[i][sink]=flow_matrix[i][sink];
-		//printMatrix(work_matrix);
-		//cout << "^ fsc" << endl;
-		int flow;
-		if(finding_method=="edmonds_karp"){
-           	flow=edmonds_karp(work_matrix,source,sink,x);
-           	x++;
-	    }
-	    //else if(finding_method=="pushRelabelMaxFlow"){
-	     	//flow=pushRelabelMaxFlow(work_matrix,source,sink);
-	    //}
-	    else{
-	     	cerr << "Invalid flow finding method." << endl;
-	     	return {};
-     	}
-     	//cout << flow << " " << iff1 <<endl;
+	// Observed states are kept as the arcs a candidate changed, [arc,capacity,residual],
+	// and handed to the observer in candidate order once the workers are done
+	vector<vector<array<int,3>>> observed(candidates);
+	vector<char> has_observed(candidates,0);
+	atomic<int> next(0);
+	auto worker=[&](){
+		ResidualNetwork scratch(work);
+		vector<pair<int,int>> undo;
+		for(int k=next++;k<candidates;k=next++){
+			if(iterations[k]<0){
+				continue;
+			}
+			int i=g.targets[first+k];
+			flows[k]+=add_edge_flow(scratch,g,source,sink,sink,i,undo);
+			if(flows[k]>0 && flow_observer){
+				has_observed[k]=1;
+				for(auto [arc,old] : undo){
+					observed[k].push_back({arc,scratch.capacity[arc],scratch.residual[arc]});
+				}
+			}
+			rollback(scratch,undo);
+			setEdgeCapacity(scratch,g,sink,i,false);
+		}
+	};
+	int threads=max(1,min(flow_threads,candidates));
+	vector<thread> pool;
+	for(int t=1;t<threads;++t){
+		pool.emplace_back(worker);
+	}
+	worker();
+	for(thread& th : pool){
+		th.join();
+	}
+	if(flow_observer){
+		ResidualNetwork view(work);
+		for(int k=0;k<candidates;++k){
+			if(!has_observed[k]){
+				continue;
+			}
+			for(auto [arc,capacity,residual] : observed[k]){
+				view.capacity[arc]=capacity;
+				view.residual[arc]=residual;
+			}
+			flow_observer(view,iterations[k]);
+			for(auto [arc,capacity,residual] : observed[k]){
+				view.capacity[arc]=work.capacity[arc];
+				view.residual[arc]=work.residual[arc];
+			}
+		}
+	}
+
+	for(int k=0;k<candidates;++k){
+		int i=g.targets[first+k];
+		int flow=flows[k];
 		if(flow-iff1>0){
 			possible_edges[j][0]=i;
 			possible_edges[j][1]=flow-iff1;
-			possible_edges[j][2]=graph[sink][i];
-			possible_edges[j][3]=static_cast<float>(flow)/graph[sink][i];
+			possible_edges[j][2]=g.lengths[first+k];
+			possible_edges[j][3]=static_cast<float>(flow)/g.lengths[first+k];
 			j++;
-			cout << "Max flow: " << flow-iff1 << ", edge: " << i << "," << sink << ", edge length: " << graph[sink][i] <<endl;
-		}
-
-		auto ifff=find(iff.begin(), iff.end(), i);
-		if(ifff==iff.end()){
-			work_matrix[sink][i]=0;
-			work_matrix[i][sink]=0;
+			cout << "Max flow: " << flow-iff1 << ", edge: " << i << "," << sink << ", edge length: " << g.lengths[first+k] <<endl;
 		}
-		
 	}
 	sortMatrixByColumn(possible_edges,3);
 	return possible_edges;
 }
 
-void choose_edges(const vector<vector<int>>& graph, const vector<vector<int>>& flow_matrix, vector<vector<float>> possible_edges, int source, int sink, int max_flow, const string finding_method){
+void choose_edges(const CSRGraph& g, vector<vector<float>> possible_edges, int source, int sink, int max_flow, const string finding_method){
 	int needed_flow_inp;
 	int n=possible_edges.size();
-	vector<vector<int>> work_matrix(flow_matrix);
-	for(int i=0;i<n;++i){
-		work_matrix[sink][i]=0;
-		work_matrix[i][sink]=0;
+	ResidualNetwork work=buildResidual(g);
+	for(int e=g.offsets[sink];e<g.offsets[sink+1];++e){
+		setEdgeCapacity(work,g,sink,g.targets[e],false);
 	}
+	work.reset();
 	vector<int> used_edges(n,-1);
 	cout << "Input needed flow: ";
 	cin >> needed_flow_inp;
@@ -300,28 +2204,24 @@ void choose_edges(const vector<vector<int>>& graph, const vector<vector<int>>& f
 	}
 	int flowFull=0;
 	int i=0;
-	//for(int i=0;i<n;++i){
 	while(flowFull<needed_flow){
-		//printMatrix(work_matrix);
-		//cout << endl;
-		work_matrix[sink][possible_edges[0][0]]=flow_matrix[sink][possible_edges[0][0]];
-		work_matrix[possible_edges[0][0]][sink]=flow_matrix[possible_edges[0][0]][sink];
-		used_edges[i]=possible_edges[0][0];
-	    //for(int z=0;z<=i;z++){
-	    //	cout << "cc" <<endl;
-	    //	cout << used_edges[z] <<"cc"<<endl;
-	    //}
-		//printMatrix(work_matrix);
-		//cout << endl;
-		if(finding_method=="edmonds_karp"){
-           	flowFull=edmonds_karp(work_matrix,source,sink,-i-2);
-           	cout << flowFull << endl;
-	    }
-
-		//if(flowFull>=needed_flow){
-		//	break;
-		//}
-		possible_edges=finding_single_connections(graph,flow_matrix,source,sink,"edmonds_karp",used_edges,flowFull);
+		int candidate=possible_edges[0][0];
+		if(g.arc(sink,candidate)!=-1){
+			enableEdge(work,g,sink,candidate);
+		}
+		used_edges[i]=candidate;
+		// Warm start, the flow of the previous round is still feasible, and only the missing flow is searched for
+		int added=find_max_flow(work,source,sink,finding_method,-i-2,needed_flow-flowFull);
+		if(added<0){
+			cerr << "Invalid flow finding method." << endl;
+			return;
+		}
+		flowFull+=added;
+		cout << flowFull << endl;
+		if(flowFull>=needed_flow){
+			break;
+		}
+		possible_edges=finding_single_connections(g,source,sink,finding_method,used_edges,flowFull);
 		i++;
 	}
 
@@ -335,7 +2235,10 @@ void choose_edges(const vector<vector<int>>& graph, const vector<vector<int>>& f
 			cout << "; ";
 		}
 		cout << used_edges[i] << "," << sink;
-		full_added_lenght+=graph[used_edges[i]][sink];
+		int e=g.arc(used_edges[i],sink);
+		if(e!=-1){
+			full_added_lenght+=g.lengths[e];
+		}
 	}
 	cout<<endl;
 	cout << "Full added length: "<<full_added_lenght<<endl;
@@ -346,32 +2249,117 @@ int main(){
     int r=1000; // Set max distance
     int f=30; // Set max flow
     float d=0.9; // Set saturation
-    vector<vector<int>> graph=generateGraph(n,d,r);
-    vector<vector<int>> flow_matrix=generateFlow(graph,f);
+    string graph_family="uniform"; // Set graph family: uniform, grid2d, grid3d, layered, barabasi_albert, rmat or bad_case
+    bool spanning_tree=true; // Build a random spanning tree first, otherwise sample uniformly and join the components
+    bool directed=false; // Give both directions of an edge their own capacity
+    uint64_t seed=random_device{}(); // Set seed, use a fixed value to replay a run
+    RandomContext random{seed};
+    cout << "Seed: " << seed << endl;
+    Philox graph_gen=random.stream(GRAPH_STREAM);
+    Philox flow_gen=random.stream(FLOW_STREAM);
+    Philox pick_gen=random.stream(PICK_STREAM);
+    string finding_method="edmonds_karp"; // Set max flow method: edmonds_karp, dinic, pushRelabelMaxFlow or parallelPushRelabel
+    flow_threads=max(1u,thread::hardware_concurrency()); // Set number of threads for parallel solvers
+    int dense_limit=50; // Bigger graphs are generated straight into CSR form, without matrices and images
+    bool render_images=false; // Draw the graph, flow and every solved residual network
+    image_format="png"; // Set image format: png drawn by Graphviz or svg written in-process
+    int render_threads=max(1u,thread::hardware_concurrency()/2); // Set number of background Graphviz workers
+    unique_ptr<RenderQueue> renderer;
+    if(render_images){
+        renderer=make_unique<RenderQueue>(render_threads);
+        render_queue=renderer.get();
+    }
+    string trace_file=""; // Set a file to record every solved residual network into one trace
+    string graph_file=""; // Set a file written by writeGraphStream to load the graph from it instead
+    string output_graph_file=""; // Set a file to stream a uniform graph of n, d, r and f into it, then stop
+    if(!output_graph_file.empty()){
+        long long edges=writeGraphStream(output_graph_file,n,d,r,f,random,flow_threads,spanning_tree,directed);
+        if(edges<0){
+            return 1;
+        }
+        cout << "Wrote " << edges << " edges to " << output_graph_file << endl;
+        return 0;
+    }
+    CSRGraph network;
+    bool connected; // Generators connect their graphs, checked here as a guard and for loaded files
+    if(!graph_file.empty()){
+        network=loadGraphStream(graph_file);
+        n=network.n;
+        if(n<2){
+            return 1;
+        }
+        connected=is_connected(network);
+    }
+    else if(graph_family=="uniform" && n<=dense_limit){
+        SymmetricMatrix<int> graph=generateGraph(n,d,r,graph_gen,spanning_tree);
+        connected=is_connected(graph);
+        auto show=[&](const auto& flow_matrix){
+            // Print generated graphs and view them as images
+            //printMatrix(graph);
+            //printMatrix(flow_matrix);
+            if(render_images){
+                generateGraphImage(graph, "graph."+image_format);
+                generateFlowImage(flow_matrix, "flow."+image_format);
+            }
+            network=toCSR(graph,flow_matrix);
+        };
+        // Undirected flows are stored packed like the graph, directed ones need the full matrix
+        if(directed){
+            show(generateFlow<Matrix<int>>(graph,f,flow_gen,true));
+        }
+        else{
+            show(generateFlow<SymmetricMatrix<int>>(graph,f,flow_gen));
+        }
+    }
+    else{
+        network=generateFamily(graph_family,n,d,r,f,random,flow_threads,spanning_tree,directed);
+        n=network.n;
+        if(n<2){
+            return 1;
+        }
+        connected=is_connected(network);
+    }
+    if(!connected){
+        cout << "Warning: the graph is not connected, some vertices can not take part in the flow" << endl;
+    }
 
-    // Print generated graphs and view them as images
-    //printMatrix(graph);
-    //printMatrix(flow_matrix);
-    generateGraphImage(graph, "graph.png");
-    generateFlowImage(flow_matrix, "flow.png");
+    unique_ptr<FlowTrace> trace;
+    if(!trace_file.empty()){
+        trace=make_unique<FlowTrace>(trace_file);
+    }
+    if(render_images || trace){
+        flow_observer=[&](const ResidualNetwork& net, int iteration){
+            if(render_images){
+                generateKarpImage(net,"karp",iteration);
+            }
+            if(trace){
+                trace->record(net,iteration);
+            }
+        };
+    }
 
-	// Set random source and sink
-    int source=uniform_int_distribution<>(0, n-1)(gen);
+	// Set random source and sink, the bad case is built around source 0 and sink 1
+    int source=uniform_int_distribution<>(0, n-1)(pick_gen);
     int sink=source;
     while(sink==source){
-    	sink=uniform_int_distribution<>(0, n-1)(gen);
+    	sink=uniform_int_distribution<>(0, n-1)(pick_gen);
+    }
+    if(graph_file.empty() && graph_family=="bad_case"){
+        source=0;
+        sink=1;
     }
 	cout << "Source: " << source << " " << "Sink:" << sink << endl;
 	
- 	auto start_timeEK = chrono::steady_clock::now();
-	int max_flowEK=edmonds_karp(flow_matrix,source,sink);
-	cout << "Max flow: " << max_flowEK << endl;
-	vector<vector<float>> possible_edgesEK=finding_single_connections(graph,flow_matrix,source,sink,"edmonds_karp");
-	auto end_timeEK = chrono::steady_clock::now(); 
-	auto timeEK=chrono::duration_cast<chrono::milliseconds>(end_timeEK - start_timeEK);
-	cout << "Time for EK: " << timeEK.count() << endl;
-	
-	choose_edges(graph, flow_matrix, possible_edgesEK, source, sink, max_flowEK, "edmonds_karp");
-	
+	auto start_time = chrono::steady_clock::now();
+	ResidualNetwork residual=buildResidual(network);
+	int max_flow=find_max_flow(residual,source,sink,finding_method);
+	cout << "Max flow: " << max_flow << endl;
+	vector<vector<float>> possible_edges=finding_single_connections(network,source,sink,finding_method);
+	auto end_time = chrono::steady_clock::now();
+	auto elapsed=chrono::duration_cast<chrono::milliseconds>(end_time - start_time);
+	cout << "Time for " << finding_method << ": " << elapsed.count() << endl;
+
+	choose_edges(network, possible_edges, source, sink, max_flow, finding_method);
+
     return 0;
 }